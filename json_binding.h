@@ -0,0 +1,380 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "./json_parser.h"
+
+using namespace std;
+
+// Typed binding on top of the lexer in json_parser.h.
+// A config struct lists its fields once in a static jsonFields() function and bindJson<T>() fills it straight from the token stream, so no JsonNode tree is ever built.
+// Object keys are dispatched through a perfect hash table that is searched for at compile time.
+
+enum class BindErrorKind {
+	SYNTAX,		// malformed JSON
+	TYPE_MISMATCH,	// value doesn't match the field type
+	MISSING_FIELD,	// a required field isn't in the object
+	DUPLICATE_FIELD	// the same field appears twice in one object
+};
+
+class JsonBindError : public runtime_error {
+public:
+	JsonBindError(BindErrorKind kind, const string& path, const string& message) : runtime_error(path + ": " + message), kind(kind), path(path) {}
+
+	BindErrorKind getKind() const {
+		return kind;
+	}
+
+	const string& getPath() const {
+		return path;
+	}
+
+private:
+	BindErrorKind kind;
+	string path;
+};
+
+template<typename T, typename M>
+struct JsonField {
+	string_view name;
+	M T::* member;
+	bool required;
+};
+
+template<typename T, typename M>
+constexpr JsonField<T, M> field(string_view name, M T::* member) {
+	return { name, member, true };
+}
+
+// The member keeps its default value when the key is absent.
+template<typename T, typename M>
+constexpr JsonField<T, M> optionalField(string_view name, M T::* member) {
+	return { name, member, false };
+}
+
+// FNV-1a with the seed folded into the offset basis, so a different seed gives a different spread of keys.
+constexpr uint32_t hashKey(string_view key, uint32_t seed) {
+	uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+	for (char c : key) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+template<size_t N>
+constexpr size_t perfectHashSize() {
+	size_t size = 1;
+	while (size < N * 2) {
+		size <<= 1;
+	}
+	return size;
+}
+
+template<size_t N>
+struct PerfectHash {
+	static constexpr size_t SIZE = perfectHashSize<N>();
+
+	array<string_view, N> keys{};
+	array<int, SIZE> slots{};
+	uint32_t seed = 0;
+	bool found = false;
+
+	// Returns the field index for the key or -1 if the key isn't one of ours.
+	constexpr int find(string_view key) const {
+		int index = slots[hashKey(key, seed) & (SIZE - 1)];
+		return index >= 0 && keys[index] == key ? index : -1;
+	}
+};
+
+// Try seeds until every key lands in its own slot.
+template<size_t N>
+constexpr PerfectHash<N> buildPerfectHash(const array<string_view, N>& keys) {
+	PerfectHash<N> table;
+	table.keys = keys;
+	for (uint32_t seed = 0; seed < 4096 && !table.found; ++seed) {
+		for (int& slot : table.slots) {
+			slot = -1;
+		}
+		table.seed = seed;
+		table.found = true;
+		for (size_t i = 0; i < N && table.found; ++i) {
+			int& slot = table.slots[hashKey(keys[i], seed) & (PerfectHash<N>::SIZE - 1)];
+			if (slot != -1) {
+				table.found = false;
+			} else {
+				slot = static_cast<int>(i);
+			}
+		}
+	}
+	return table;
+}
+
+class JsonReader {
+public:
+	JsonReader(const string& input) : lexer(input) {
+		advance("$");
+	}
+
+	const Token& peek() const {
+		return currentToken;
+	}
+
+	Token take(const string& path) {
+		Token token = move(currentToken);
+		advance(path);
+		return token;
+	}
+
+	void expect(TokenType type, const string& path, const char* what) {
+		if (currentToken.type != type) {
+			throw JsonBindError(BindErrorKind::SYNTAX, path, string("expected ") + what);
+		}
+		advance(path);
+	}
+
+	// Commas are optional between members, the same as in Parser.
+	void skipComma(const string& path) {
+		if (currentToken.type == COMMA) {
+			advance(path);
+		}
+	}
+
+	// Consume a value we have no field for without building anything.
+	void skipValue(const string& path) {
+		vector<TokenType> open;
+		do {
+			switch (currentToken.type) {
+				case LEFT_BRACE: open.push_back(RIGHT_BRACE); break;
+				case LEFT_BRACKET: open.push_back(RIGHT_BRACKET); break;
+				case RIGHT_BRACE: case RIGHT_BRACKET:
+					if (open.empty() || open.back() != currentToken.type) {
+						throw JsonBindError(BindErrorKind::SYNTAX, path, "unexpected '" + currentToken.value + "'");
+					}
+					open.pop_back();
+					break;
+				case COMMA: case COLON:
+					if (open.empty()) {
+						throw JsonBindError(BindErrorKind::SYNTAX, path, "unexpected '" + currentToken.value + "'");
+					}
+					break;
+				case END_OF_FILE: throw JsonBindError(BindErrorKind::SYNTAX, path, "unexpected end of input");
+				default: break;
+			}
+			advance(path);
+		} while (!open.empty());
+	}
+
+	// True at the closing token of the array or object being read, a syntax error at the wrong closing token or the end of input.
+	bool atClose(TokenType close, const string& path) const {
+		if (currentToken.type == close) {
+			return true;
+		}
+		if (currentToken.type == END_OF_FILE) {
+			throw JsonBindError(BindErrorKind::SYNTAX, path, "unexpected end of input");
+		}
+		if (currentToken.type == RIGHT_BRACE || currentToken.type == RIGHT_BRACKET) {
+			throw JsonBindError(BindErrorKind::SYNTAX, path, "unexpected '" + currentToken.value + "'");
+		}
+		return false;
+	}
+
+	// A value of the wrong type is a type mismatch, but no value at all is a syntax error.
+	[[noreturn]] void mismatch(const string& path, const string& what) const {
+		switch (currentToken.type) {
+			case STRING: case NUMBER: case BOOLEAN: case NUL: case LEFT_BRACE: case LEFT_BRACKET:
+				throw JsonBindError(BindErrorKind::TYPE_MISMATCH, path, "expected " + what);
+			case END_OF_FILE:
+				throw JsonBindError(BindErrorKind::SYNTAX, path, "unexpected end of input");
+			default:
+				throw JsonBindError(BindErrorKind::SYNTAX, path, "unexpected '" + currentToken.value + "'");
+		}
+	}
+
+	void expectEnd() {
+		if (currentToken.type != END_OF_FILE) {
+			throw JsonBindError(BindErrorKind::SYNTAX, "$", "trailing data after root value");
+		}
+	}
+
+private:
+	Lexer lexer;
+	Token currentToken;
+
+	void advance(const string& path) {
+		try {
+			currentToken = lexer.nextToken();
+		} catch (const runtime_error& e) {
+			throw JsonBindError(BindErrorKind::SYNTAX, path, e.what());
+		}
+	}
+};
+
+template<typename T, typename = void>
+struct HasJsonFields : false_type {};
+template<typename T>
+struct HasJsonFields<T, void_t<decltype(T::jsonFields())>> : true_type {};
+
+template<typename T, typename = void>
+struct JsonBinder;
+
+template<typename T>
+void readJson(JsonReader& reader, T& out, const string& path) {
+	JsonBinder<T>::read(reader, out, path);
+}
+
+template<typename T>
+struct JsonBinder<T, enable_if_t<is_arithmetic_v<T> && !is_same_v<T, bool>>> {
+	static void read(JsonReader& reader, T& out, const string& path) {
+		if (reader.peek().type != NUMBER) {
+			reader.mismatch(path, "a number");
+		}
+		// the lexer hands over anything made of digits, '.' and '-', so the whole token has to parse
+		const string& token = reader.peek().value;
+		double value;
+		size_t parsed = 0;
+		try {
+			value = stod(token, &parsed);
+		} catch (const exception&) {
+			parsed = 0;
+		}
+		if (parsed == 0 || parsed != token.size()) {
+			throw JsonBindError(BindErrorKind::SYNTAX, path, "malformed number '" + token + "'");
+		}
+		if constexpr (is_integral_v<T>) {
+			if (value != floor(value)) {
+				throw JsonBindError(BindErrorKind::TYPE_MISMATCH, path, "expected an integer");
+			}
+			// max() + 1 is a power of two, so it's exact as a double where max() itself may not be
+			if (value < static_cast<double>(numeric_limits<T>::min()) || value >= static_cast<double>(numeric_limits<T>::max()) + 1.0) {
+				throw JsonBindError(BindErrorKind::TYPE_MISMATCH, path, "number '" + token + "' is out of range");
+			}
+		} else if (fabs(value) > static_cast<double>(numeric_limits<T>::max())) {
+			throw JsonBindError(BindErrorKind::TYPE_MISMATCH, path, "number '" + token + "' is out of range");
+		}
+		out = static_cast<T>(value);
+		reader.take(path);
+	}
+};
+
+template<>
+struct JsonBinder<bool> {
+	static void read(JsonReader& reader, bool& out, const string& path) {
+		if (reader.peek().type != BOOLEAN) {
+			reader.mismatch(path, "a boolean");
+		}
+		out = reader.take(path).value == "true";
+	}
+};
+
+template<>
+struct JsonBinder<string> {
+	static void read(JsonReader& reader, string& out, const string& path) {
+		if (reader.peek().type != STRING) {
+			reader.mismatch(path, "a string");
+		}
+		out = reader.take(path).value;
+	}
+};
+
+template<typename T>
+struct JsonBinder<vector<T>> {
+	static void read(JsonReader& reader, vector<T>& out, const string& path) {
+		if (reader.peek().type != LEFT_BRACKET) {
+			reader.mismatch(path, "an array");
+		}
+		reader.take(path);
+		out.clear();
+		while (!reader.atClose(RIGHT_BRACKET, path)) {
+			out.emplace_back();
+			readJson(reader, out.back(), path + "[" + to_string(out.size() - 1) + "]");
+			reader.skipComma(path);
+		}
+		reader.take(path);
+	}
+};
+
+// Objects whose keys are data rather than field names (e.g. level paths).
+template<typename T>
+struct JsonBinder<map<string, T>> {
+	static void read(JsonReader& reader, map<string, T>& out, const string& path) {
+		if (reader.peek().type != LEFT_BRACE) {
+			reader.mismatch(path, "an object");
+		}
+		reader.take(path);
+		out.clear();
+		while (!reader.atClose(RIGHT_BRACE, path)) {
+			if (reader.peek().type != STRING) {
+				throw JsonBindError(BindErrorKind::SYNTAX, path, "expected a string as key");
+			}
+			string key = reader.take(path).value;
+			reader.expect(COLON, path, "':'");
+			readJson(reader, out[key], path + "[\"" + key + "\"]");
+			reader.skipComma(path);
+		}
+		reader.take(path);
+	}
+};
+
+template<typename T>
+struct JsonBinder<T, enable_if_t<HasJsonFields<T>::value>> {
+	static constexpr auto fields = T::jsonFields();
+	static constexpr size_t N = tuple_size_v<decay_t<decltype(fields)>>;
+	static constexpr auto table = buildPerfectHash(apply([](auto... f) { return array<string_view, N>{ f.name... }; }, fields));
+	static_assert(table.found, "No perfect hash seed found for the field names");
+
+	static void read(JsonReader& reader, T& out, const string& path) {
+		if (reader.peek().type != LEFT_BRACE) {
+			reader.mismatch(path, "an object");
+		}
+		reader.take(path);
+		array<bool, N> seen{};
+		while (!reader.atClose(RIGHT_BRACE, path)) {
+			if (reader.peek().type != STRING) {
+				throw JsonBindError(BindErrorKind::SYNTAX, path, "expected a string as key");
+			}
+			string key = reader.take(path).value;
+			reader.expect(COLON, path, "':'");
+			int index = table.find(key);
+			if (index < 0) {
+				// unknown keys are ignored so configs can carry extra data
+				reader.skipValue(path + "." + key);
+			} else {
+				if (seen[index]) {
+					throw JsonBindError(BindErrorKind::DUPLICATE_FIELD, path + "." + key, "field appears more than once");
+				}
+				seen[index] = true;
+				readField(index, reader, out, path + "." + key, make_index_sequence<N>{});
+			}
+			reader.skipComma(path);
+		}
+		reader.take(path);
+		checkRequired(seen, path, make_index_sequence<N>{});
+	}
+
+private:
+	template<size_t... I>
+	static void readField(int index, JsonReader& reader, T& out, const string& path, index_sequence<I...>) {
+		((index == static_cast<int>(I) ? (readJson(reader, out.*(get<I>(fields).member), path), true) : false) || ...);
+	}
+
+	template<size_t... I>
+	static void checkRequired(const array<bool, N>& seen, const string& path, index_sequence<I...>) {
+		(((get<I>(fields).required && !seen[I]) ? throw JsonBindError(BindErrorKind::MISSING_FIELD, path + "." + string(get<I>(fields).name), "required field is missing") : void()), ...);
+	}
+};
+
+template<typename T>
+T bindJson(const string& input) {
+	JsonReader reader(input);
+	T out{};
+	readJson(reader, out, "$");
+	reader.expectEnd();
+	return out;
+}
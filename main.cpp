@@ -7,7 +7,13 @@
 #include <vector>
 #include <queue>
 #include <cmath>
-#include "./json_parser.h"
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include "./json_binding.h"
+#include "./rewind_buffer.h"
 
 using namespace std;
 
@@ -15,9 +21,19 @@ typedef unsigned char u8;
 
 const int WINDOW_WIDTH = 800;
 const int WINDOW_HEIGHT = 600;
-const float PLAYER_SPEED = 5;
-const float GRAVITY = 0.2f;
-const float JUMP_FORCE = 10;
+const size_t TICKS_PER_SECOND = 60;	// the world steps at this rate whatever the refresh rate is
+const int MAX_TICKS_PER_FRAME = 5;	// after a long stall, drop the backlog instead of fast-forwarding through it
+const size_t REWIND_TICKS = TICKS_PER_SECOND * 60 * 5;	// five minutes
+const size_t REWIND_BYTES = 512 * 1024;	// enough for five minutes of a level with a couple of patrollers, busier levels keep less
+const size_t REWIND_KEYFRAME_INTERVAL = 60;
+const float DEFAULT_ENEMY_SPEED = 1;
+// colors that can be painted in edit mode, picked with the number keys
+const u8 EDIT_COLORS[][3] = {
+	{ 255, 255, 255 },	// platform
+	{ 0, 255, 0 },		// checkpoint
+	{ 255, 0, 0 },		// patrolling enemy
+	{ 255, 255, 0 }		// stationary enemy
+};
 
 struct Object {
 	float x, y;
@@ -33,29 +49,106 @@ struct Enemy : Object {
 	enum class Type { PATROL, STATIONARY };
 	float dx, dy;
 	Type type;
+	float originX;	// where it was placed in the bitmap, patrolling enemies move away from it
 };
 
+// config.json layout, bound by json_binding.h
+struct PhysicsConfig {
+	float playerSpeed = 5;
+	float gravity = 0.2f;
+	float jumpForce = 10;
+
+	static constexpr auto jsonFields() {
+		return make_tuple(
+			optionalField("player_speed", &PhysicsConfig::playerSpeed),
+			optionalField("gravity", &PhysicsConfig::gravity),
+			optionalField("jump_force", &PhysicsConfig::jumpForce)
+		);
+	}
+};
+struct EnemyConfig {
+	vector<float> speed;
+
+	static constexpr auto jsonFields() {
+		return make_tuple(field("speed", &EnemyConfig::speed));
+	}
+};
+struct LevelConfig {
+	EnemyConfig enemies;
+
+	static constexpr auto jsonFields() {
+		return make_tuple(field("enemies", &LevelConfig::enemies));
+	}
+};
+struct GameConfig {
+	map<string, LevelConfig> levels;
+	PhysicsConfig physics;
+
+	static constexpr auto jsonFields() {
+		return make_tuple(
+			field("levels", &GameConfig::levels),
+			optionalField("physics", &GameConfig::physics)
+		);
+	}
+};
+
+// A level decoded and split into objects at startup, ready for loadLevel.
+struct LevelData {
+	string path;
+	vector<float> enemySpeeds;
+	vector<u8> image;
+	int width = 0, height = 0;
+	Object spawn;
+	vector<Object> platforms;
+	vector<Object> checkpoints;
+	vector<Object> patrolEnemies;
+	vector<Object> stationaryEnemies;
+	string error;	// empty when the level is valid
+};
+
+PhysicsConfig physics;
 Player player;
 float spawnX, spawnY;
 vector<Platform> platforms;
 vector<Checkpoint> checkpoints;
 vector<Enemy> enemies;
-vector<pair<float, float>> enemySpeeds;
-int enemyCount = 0;
-vector<string> levels;
+vector<LevelData> levels;
+mutex soilMutex;	// SOIL keeps its last error in globals, so only one thread may call into it at a time (see decodeBitmap)
 int currentLevel = 0;
+RewindBuffer history(REWIND_TICKS, REWIND_BYTES, REWIND_KEYFRAME_INTERVAL);
+vector<u8> worldState;
+bool rewinding = false;
+size_t rewindTick = 0;
+vector<u8> levelImage;
+int levelWidth, levelHeight;
+float levelXScale, levelYScale;
+bool editing = false;
+int editColor = 0;
+int mouseButton = -1;
 
 void loadExternalData();
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+void cursorPosCallback(GLFWwindow* window, double x, double y);
+void paintPixel(int x, int y, const u8* color);
+void remeshRegion(Object region, const u8* oldColor, const u8* newColor);
 void updatePlayer();
 u8 getCollisionDirection(const Object& player, const Object& object, int xRange = 0, int yRange = 0);
 void die();
 void handleCollision();
 void updateEnemies();
 void renderScene();
-vector<Object> aggregateObject(const char* filepath, u8 r, u8 g, u8 b);
-void unloadBitmap();
-void loadBitmap(const char* filepath);
+void saveWorld(vector<u8>& state);
+void loadWorld(const vector<u8>& state);
+void recordWorld();
+void rewindWorld();
+vector<Object> aggregateObject(unsigned char* image, int width, int height, u8 r, u8 g, u8 b, int minX = 0, int minY = 0, int maxX = -1, int maxY = -1);
+bool decodeBitmap(const string& path, vector<u8>& image, int& width, int& height);
+void preprocessLevel(LevelData& level);
+void preprocessLevels();
+void unloadLevel();
+void loadLevel(const LevelData& level);
+void addEnemy(const Object& object, Enemy::Type type, float speed = 0.0f);
 
 int main() {
 	if (!glfwInit()) {
@@ -72,7 +165,10 @@ int main() {
 	}
 
 	glfwMakeContextCurrent(window);
+	glfwSwapInterval(1);
 	glfwSetKeyCallback(window, keyCallback);
+	glfwSetMouseButtonCallback(window, mouseButtonCallback);
+	glfwSetCursorPosCallback(window, cursorPosCallback);
 
 	if (glewInit() != GLEW_OK) {
 		cerr << "Failed to initialize GLEW" << endl;
@@ -83,12 +179,33 @@ int main() {
 
 	loadExternalData();
 
+	const double tickSeconds = 1.0 / TICKS_PER_SECOND;
+	double previousTime = glfwGetTime();
+	double lag = 0.0;
 	while (!glfwWindowShouldClose(window)) {
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		updatePlayer();
-		updateEnemies();
-		handleCollision();
+		// fixed timestep, so a tick (and a tick of rewind history) is always 1/60 s
+		double currentTime = glfwGetTime();
+		lag += currentTime - previousTime;
+		previousTime = currentTime;
+		for (int ticks = 0; lag >= tickSeconds; ++ticks) {
+			if (ticks == MAX_TICKS_PER_FRAME) {
+				lag = 0.0;
+				break;
+			}
+			lag -= tickSeconds;
+			if (editing) {
+				// the world stays frozen while it's being painted
+			} else if (rewinding) {
+				rewindWorld();
+			} else {
+				updatePlayer();
+				updateEnemies();
+				handleCollision();
+				recordWorld();
+			}
+		}
 		renderScene();
 
 		glfwSwapBuffers(window);
@@ -110,27 +227,26 @@ void loadExternalData() {
 	buffer << file.rdbuf();
 	std::string input = buffer.str();
 
-	Parser parser(input);
-	auto root = parser.parse();
-	auto _levels = get_if<JsonNode::JsonObject>(&(*root)["levels"]->getValue());
-	if (!_levels) {
-		cerr << "Expected an array of levels" << endl;
+	GameConfig config;
+	try {
+		config = bindJson<GameConfig>(input);
+	} catch (const JsonBindError& e) {
+		cerr << "Invalid config: " << e.what() << endl;
 		exit(EXIT_FAILURE);
 	}
-	for (const auto& level : *_levels) {
-		levels.push_back(level.first);
-		shared_ptr<JsonNode> _enemySpeeds = (*(*level.second)["enemies"])["speed"];
-		auto enemySpeedsArray = get_if<JsonNode::JsonArray>(&_enemySpeeds->getValue());
-		if (!enemySpeedsArray) {
-			cerr << "Expected an array of enemy speeds" << endl;
-			exit(EXIT_FAILURE);
-		}
-		for (const auto& enemySpeed : *enemySpeedsArray) {
-			float _speed = get<double>(enemySpeed->getValue());
-			enemySpeeds.push_back({ _speed, _speed });
-		}
+	physics = config.physics;
+	if (config.levels.empty()) {
+		cerr << "Invalid config: no levels" << endl;
+		exit(EXIT_FAILURE);
 	}
-	loadBitmap(levels[0].c_str());
+	for (const auto& [path, level] : config.levels) {
+		LevelData data;
+		data.path = path;
+		data.enemySpeeds = level.enemies.speed;
+		levels.push_back(move(data));
+	}
+	preprocessLevels();
+	loadLevel(levels[0]);
 }
 
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -138,20 +254,75 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
 	}
 
+	// E toggles edit mode: 1-4 pick a color, left click paints and right click erases
+	if (key == GLFW_KEY_E && action == GLFW_PRESS && !rewinding) {
+		editing = !editing;
+		mouseButton = -1;
+	}
+	if (editing && action == GLFW_PRESS && key >= GLFW_KEY_1 && key < GLFW_KEY_1 + static_cast<int>(size(EDIT_COLORS))) {
+		editColor = key - GLFW_KEY_1;
+	}
+
+	// hold R to step back through the history, gameplay carries on from wherever it's released
+	if (key == GLFW_KEY_R && action == GLFW_PRESS && !editing && !history.empty()) {
+		rewinding = true;
+		rewindTick = history.newestTick();
+	} else if (key == GLFW_KEY_R && action == GLFW_RELEASE && rewinding) {
+		rewinding = false;
+		history.truncate(rewindTick);
+		// the restored velocity belongs to the past, so go by the keys that are held now
+		if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
+			player.dx = -physics.playerSpeed;
+		} else if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
+			player.dx = physics.playerSpeed;
+		} else {
+			player.dx = 0.0f;
+		}
+		double seconds = static_cast<double>(history.tickCount()) / TICKS_PER_SECOND;
+		double kilobytes = history.payloadSize() / 1024.0;
+		cout << "Rewind history: " << history.tickCount() << " ticks, " << seconds << " s, " << kilobytes << " KB";
+		if (seconds > 0) {
+			cout << " (" << kilobytes / seconds << " KB/s)";
+		}
+		cout << " of " << history.memoryUsage() / 1024.0 << " KB allocated" << endl;
+	}
+
 	if (key == GLFW_KEY_LEFT) {
-		player.dx = (action != GLFW_RELEASE) ? -PLAYER_SPEED : 0.0f;
+		player.dx = (action != GLFW_RELEASE) ? -physics.playerSpeed : 0.0f;
 	} else if (key == GLFW_KEY_RIGHT) {
-		player.dx = (action != GLFW_RELEASE) ? PLAYER_SPEED : 0.0f;
+		player.dx = (action != GLFW_RELEASE) ? physics.playerSpeed : 0.0f;
 	}
 
 	if ((key == GLFW_KEY_SPACE || key == GLFW_KEY_UP) && action == GLFW_PRESS && player.onGround) {
-		player.dy = -JUMP_FORCE;
+		player.dy = -physics.jumpForce;
 		player.onGround = false;
 	}
 }
 
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+	if (!editing || (button != GLFW_MOUSE_BUTTON_LEFT && button != GLFW_MOUSE_BUTTON_RIGHT)) {
+		return;
+	}
+	if (action == GLFW_PRESS) {
+		mouseButton = button;
+		double x, y;
+		glfwGetCursorPos(window, &x, &y);
+		cursorPosCallback(window, x, y);
+	} else if (button == mouseButton) {
+		mouseButton = -1;
+	}
+}
+
+void cursorPosCallback(GLFWwindow* window, double x, double y) {
+	if (!editing || mouseButton == -1) {
+		return;
+	}
+	static const u8 empty[3] = { 0, 0, 0 };
+	paintPixel(static_cast<int>(x / levelXScale), static_cast<int>(y / levelYScale), mouseButton == GLFW_MOUSE_BUTTON_LEFT ? EDIT_COLORS[editColor] : empty);
+}
+
 void updatePlayer() {
-	player.dy += GRAVITY;
+	player.dy += physics.gravity;
 	player.x += player.dx;
 	player.y += player.dy;
 }
@@ -231,7 +402,7 @@ void handleCollision() {
 	for (const auto& checkpoint : checkpoints) {
 		u8 direction = getCollisionDirection(player, checkpoint);
 		if (direction != 0b0000) {
-			loadBitmap(levels[++currentLevel].c_str());
+			loadLevel(levels[++currentLevel]);
 		}
 	}
 
@@ -324,10 +495,90 @@ void renderScene() {
 	glVertex2f(player.x + player.width, player.y + player.height);
 	glVertex2f(player.x, player.y + player.height);
 	glEnd();
+
+	if (editing) {
+		// outline the level in the color being painted
+		const u8* color = EDIT_COLORS[editColor];
+		glColor3f(color[0] / 255.0f, color[1] / 255.0f, color[2] / 255.0f);
+		glBegin(GL_LINE_LOOP);
+		glVertex2f(1, 1);
+		glVertex2f(levelWidth * levelXScale - 1, 1);
+		glVertex2f(levelWidth * levelXScale - 1, levelHeight * levelYScale - 1);
+		glVertex2f(1, levelHeight * levelYScale - 1);
+		glEnd();
+	}
+}
+
+template<typename T>
+void writeState(vector<u8>& state, T value) {
+	const u8* bytes = reinterpret_cast<const u8*>(&value);
+	state.insert(state.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+T readState(const vector<u8>& state, size_t& position) {
+	T value;
+	memcpy(&value, &state[position], sizeof(T));
+	position += sizeof(T);
+	return value;
+}
+
+// Only what changes from tick to tick goes in: the player and the patrolling enemies.
+void saveWorld(vector<u8>& state) {
+	state.clear();
+	writeState(state, player.x);
+	writeState(state, player.y);
+	writeState(state, player.dx);
+	writeState(state, player.dy);
+	writeState(state, player.onGround);
+	for (const auto& enemy : enemies) {
+		if (enemy.type == Enemy::Type::PATROL) {
+			writeState(state, enemy.x);
+			writeState(state, enemy.y);
+			writeState(state, enemy.dx);
+		}
+	}
+}
+
+void loadWorld(const vector<u8>& state) {
+	size_t position = 0;
+	player.x = readState<float>(state, position);
+	player.y = readState<float>(state, position);
+	player.dx = readState<float>(state, position);
+	player.dy = readState<float>(state, position);
+	player.onGround = readState<bool>(state, position);
+	for (auto& enemy : enemies) {
+		if (enemy.type == Enemy::Type::PATROL) {
+			enemy.x = readState<float>(state, position);
+			enemy.y = readState<float>(state, position);
+			enemy.dx = readState<float>(state, position);
+		}
+	}
 }
 
-vector<Object> aggregateObject(unsigned char* image, int width, int height, u8 r, u8 g, u8 b) {
+void recordWorld() {
+	saveWorld(worldState);
+	history.record(worldState);
+}
+
+void rewindWorld() {
+	if (rewindTick > history.oldestTick()) {
+		rewindTick--;
+	}
+	if (history.restore(rewindTick, worldState)) {
+		loadWorld(worldState);
+	}
+}
+
+// Only the pixels in [minX, maxX) x [minY, maxY) are looked at, the whole image by default.
+vector<Object> aggregateObject(unsigned char* image, int width, int height, u8 r, u8 g, u8 b, int minX, int minY, int maxX, int maxY) {
 	vector<Object> tmpObjects;
+	if (maxX < 0) {
+		maxX = width;
+	}
+	if (maxY < 0) {
+		maxY = height;
+	}
 
 	float xScale = WINDOW_WIDTH / width;
 	float yScale = WINDOW_HEIGHT / height;
@@ -372,24 +623,25 @@ vector<Object> aggregateObject(unsigned char* image, int width, int height, u8 r
 	// }
 
 	// I wanted to use flood fill but if multiple objects are touching each other, then the flood fill algorithm will treat them as one object, but this doesn't work, since I'm dealing with rectangles, not meshes with various points to make up a shape.
-	vector<vector<bool>> visited(height, vector<bool>(width, false));
-	for (int y = height - 1; y >= 0; --y) {
-		for (int x = 0; x < width; ++x) {
-			if (visited[y][x]) {
+	// only as big as the window being scanned, indexed relative to its corner
+	vector<vector<bool>> visited(maxY - minY, vector<bool>(maxX - minX, false));
+	for (int y = maxY - 1; y >= minY; --y) {
+		for (int x = minX; x < maxX; ++x) {
+			if (visited[y - minY][x - minX]) {
 				continue;
 			}
 			if (image[(x + y * width) * 3] == r && image[(x + y * width) * 3 + 1] == g && image[(x + y * width) * 3 + 2] == b) {
-				int minX = x, maxX = x, minY = y, maxY = y;
-				while (x < width && image[(x + y * width) * 3] == r && image[(x + y * width) * 3 + 1] == g && image[(x + y * width) * 3 + 2] == b) {
-					for (int i = minY; i <= maxY; ++i) {
-						for (int j = minX; j <= maxX; ++j) {
-							visited[i][j] = true;
+				int runMinX = x, runMaxX = x, runMinY = y, runMaxY = y;
+				while (x < maxX && image[(x + y * width) * 3] == r && image[(x + y * width) * 3 + 1] == g && image[(x + y * width) * 3 + 2] == b) {
+					for (int i = runMinY; i <= runMaxY; ++i) {
+						for (int j = runMinX; j <= runMaxX; ++j) {
+							visited[i - minY][j - minX] = true;
 						}
 					}
-					maxX = x;
+					runMaxX = x;
 					x++;
 				}
-				Object object = { static_cast<float>(minX) * xScale, static_cast<float>(minY) * yScale, (maxX - minX + 1) * xScale, (maxY - minY + 1) * yScale };
+				Object object = { static_cast<float>(runMinX) * xScale, static_cast<float>(runMinY) * yScale, (runMaxX - runMinX + 1) * xScale, (runMaxY - runMinY + 1) * yScale };
 				tmpObjects.push_back(object);
 			}
 		}
@@ -421,53 +673,285 @@ vector<Object> aggregateObject(unsigned char* image, int width, int height, u8 r
 	return optimizedObjects;
 }
 
-void unloadBitmap() {
-	platforms.clear();
-	checkpoints.clear();
-	enemies.clear();
+// Reads an uncompressed 24 or 32-bit BMP (what level_editor.py saves) into top-down RGB.
+// Unlike SOIL it keeps no global state, so the preprocessing workers can all decode at once.
+bool decodeBitmap(const string& path, vector<u8>& image, int& width, int& height) {
+	ifstream file(path, ios::binary);
+	if (!file) {
+		return false;
+	}
+	vector<u8> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	auto read16 = [&](size_t position) {
+		return static_cast<uint32_t>(data[position] | data[position + 1] << 8);
+	};
+	auto read32 = [&](size_t position) {
+		return read16(position) | read16(position + 2) << 16;
+	};
+	if (data.size() < 54 || data[0] != 'B' || data[1] != 'M' || read32(14) < 40) {
+		return false;
+	}
+	uint32_t offset = read32(10);
+	int32_t fileWidth = static_cast<int32_t>(read32(18));
+	int32_t fileHeight = static_cast<int32_t>(read32(22));
+	uint32_t bitsPerPixel = read16(28);
+	if (read32(30) != 0 || (bitsPerPixel != 24 && bitsPerPixel != 32) || fileWidth <= 0 || fileWidth > 1 << 15 || fileHeight == 0 || fileHeight > 1 << 15 || fileHeight < -(1 << 15)) {
+		return false;
+	}
+	// rows are stored bottom-up unless the height is negative, each padded to 4 bytes
+	bool topDown = fileHeight < 0;
+	width = fileWidth;
+	height = topDown ? -fileHeight : fileHeight;
+	size_t bytesPerPixel = bitsPerPixel / 8;
+	size_t stride = (width * bytesPerPixel + 3) & ~size_t(3);
+	if (offset + stride * height > data.size()) {
+		return false;
+	}
+	image.resize(static_cast<size_t>(width) * height * 3);
+	for (int y = 0; y < height; ++y) {
+		const u8* row = &data[offset + stride * (topDown ? y : height - 1 - y)];
+		for (int x = 0; x < width; ++x) {
+			u8* pixel = &image[(x + y * width) * 3];
+			pixel[0] = row[x * bytesPerPixel + 2];
+			pixel[1] = row[x * bytesPerPixel + 1];
+			pixel[2] = row[x * bytesPerPixel];
+		}
+	}
+	return true;
 }
 
-void loadBitmap(const char* filepath) {
-	unloadBitmap();
-
+// Decode and mesh one level and check it against its config.
+// Runs on the preprocessing workers. Plain BMPs are decoded in parallel; anything else goes through SOIL, one level at a time under soilMutex.
+void preprocessLevel(LevelData& level) {
 	int width, height;
-	unsigned char* image = SOIL_load_image(filepath, &width, &height, 0, SOIL_LOAD_RGB);
-	if (!image) {
-		cerr << "Failed to load bitmap" << endl;
+	if (!decodeBitmap(level.path, level.image, width, height)) {
+		lock_guard<mutex> lock(soilMutex);
+		unsigned char* image = SOIL_load_image(level.path.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+		if (!image) {
+			level.error = "failed to load bitmap";
+			return;
+		}
+		level.image.assign(image, image + width * height * 3);
+		SOIL_free_image_data(image);
+	}
+	level.width = width;
+	level.height = height;
+
+	vector<Object> spawns = aggregateObject(level.image.data(), width, height, 0, 0, 255);
+	if (spawns.size() != 1) {
+		level.error = "expected exactly one blue spawn but found " + to_string(spawns.size());
+		return;
+	}
+	level.spawn = spawns[0];
+	level.platforms = aggregateObject(level.image.data(), width, height, 255, 255, 255);
+	level.checkpoints = aggregateObject(level.image.data(), width, height, 0, 255, 0);
+	level.patrolEnemies = aggregateObject(level.image.data(), width, height, 255, 0, 0);
+	level.stationaryEnemies = aggregateObject(level.image.data(), width, height, 255, 255, 0);
+	if (level.patrolEnemies.size() != level.enemySpeeds.size()) {
+		level.error = "found " + to_string(level.patrolEnemies.size()) + " patrolling enemies but " + to_string(level.enemySpeeds.size()) + " speeds in config.json";
+	}
+}
+
+// Preprocess every level up front, one level at a time per worker, so a broken level is caught before the game starts.
+void preprocessLevels() {
+	auto start = chrono::steady_clock::now();
+
+	size_t threadCount = min<size_t>(max(thread::hardware_concurrency(), 1u), levels.size());
+	atomic<size_t> nextLevel{ 0 };
+	vector<thread> workers;
+	for (size_t i = 0; i < threadCount; ++i) {
+		workers.emplace_back([&nextLevel]() {
+			for (size_t index = nextLevel++; index < levels.size(); index = nextLevel++) {
+				preprocessLevel(levels[index]);
+			}
+		});
+	}
+	for (thread& worker : workers) {
+		worker.join();
+	}
+
+	double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "Preprocessed " << levels.size() << " levels on " << threadCount << " threads in " << milliseconds << " ms" << endl;
+
+	bool valid = true;
+	for (const LevelData& level : levels) {
+		if (!level.error.empty()) {
+			cerr << level.path << ": " << level.error << endl;
+			valid = false;
+		}
+	}
+	if (!valid) {
 		exit(EXIT_FAILURE);
 	}
+}
 
-	float xScale = WINDOW_WIDTH / width;
-	float yScale = WINDOW_HEIGHT / height;
+void unloadLevel() {
+	platforms.clear();
+	checkpoints.clear();
+	enemies.clear();
+}
 
-	vector<Object> playerObject = aggregateObject(image, width, height, 0, 0, 255);
-	player.x = playerObject[0].x;
-	player.y = playerObject[0].y;
-	player.width = playerObject[0].width;
-	player.height = playerObject[0].height;
+void loadLevel(const LevelData& level) {
+	unloadLevel();
+	// the history only makes sense for the level it was recorded in
+	history.clear();
+
+	// edits go to a copy so reloading the level starts from the bitmap again
+	levelImage = level.image;
+	levelWidth = level.width;
+	levelHeight = level.height;
+	levelXScale = WINDOW_WIDTH / level.width;
+	levelYScale = WINDOW_HEIGHT / level.height;
+
+	player.x = level.spawn.x;
+	player.y = level.spawn.y;
+	player.width = level.spawn.width;
+	player.height = level.spawn.height;
 	spawnX = player.x;
 	spawnY = player.y;
-	vector<Object> platformObjects = aggregateObject(image, width, height, 255, 255, 255);
-	for (const Platform& platform : reinterpret_cast<const vector<Platform>&>(platformObjects)) {
-		platforms.push_back(platform);
+	for (const Object& platform : level.platforms) {
+		platforms.push_back({ platform });
 	}
-	vector<Object> checkpointObjects = aggregateObject(image, width, height, 0, 255, 0);
-	for (const Checkpoint& checkpoint : reinterpret_cast<const vector<Checkpoint>&>(checkpointObjects)) {
-		checkpoints.push_back(checkpoint);
+	for (const Object& checkpoint : level.checkpoints) {
+		checkpoints.push_back({ checkpoint });
 	}
-	vector<Object> enemyObjects = aggregateObject(image, width, height, 255, 0, 0);
-	for (const Object& enemy : enemyObjects) {
-		Enemy _enemy = { enemy.x, enemy.y, enemy.width, enemy.height, enemySpeeds[enemyCount].first, enemySpeeds[enemyCount].second };
-		_enemy.type = Enemy::Type::PATROL;
-		enemies.push_back(_enemy);
-		enemyCount++;
+	for (size_t i = 0; i < level.patrolEnemies.size(); ++i) {
+		addEnemy(level.patrolEnemies[i], Enemy::Type::PATROL, level.enemySpeeds[i]);
 	}
-	enemyObjects = aggregateObject(image, width, height, 255, 255, 0);
-	for (const Object& enemy : enemyObjects) {
-		Enemy _enemy = { enemy.x, enemy.y, enemy.width, enemy.height };
-		_enemy.type = Enemy::Type::STATIONARY;
-		enemies.push_back(_enemy);
+	for (const Object& enemy : level.stationaryEnemies) {
+		addEnemy(enemy, Enemy::Type::STATIONARY);
+	}
+}
+
+void addEnemy(const Object& object, Enemy::Type type, float speed) {
+	Enemy enemy = { object.x, object.y, object.width, object.height, speed, speed };
+	enemy.type = type;
+	enemy.originX = object.x;
+	enemies.push_back(enemy);
+}
+
+bool overlaps(const Object& a, const Object& b) {
+	return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+Object enemyOrigin(const Enemy& enemy) {
+	return { enemy.originX, enemy.y, enemy.width, enemy.height };
+}
+
+void paintPixel(int x, int y, const u8* color) {
+	if (x < 0 || x >= levelWidth || y < 0 || y >= levelHeight) {
+		return;
+	}
+	u8* pixel = &levelImage[(x + y * levelWidth) * 3];
+	if (equal(pixel, pixel + 3, color)) {
+		return;
+	}
+	u8 oldColor[3] = { pixel[0], pixel[1], pixel[2] };
+	copy(color, color + 3, pixel);
+
+	// take a pixel of margin so the new pixel can join up with its neighbours
+	int minX = max(x - 1, 0), minY = max(y - 1, 0);
+	int maxX = min(x + 2, levelWidth), maxY = min(y + 2, levelHeight);
+	remeshRegion({ minX * levelXScale, minY * levelYScale, (maxX - minX) * levelXScale, (maxY - minY) * levelYScale }, oldColor, color);
+}
+
+// Rebuild the objects of the two colors inside the region instead of the whole level.
+// The region first grows until it fully contains every object of those colors that it touches, so everything removed gets rebuilt from the image and nothing outside of it changes.
+void remeshRegion(Object region, const u8* oldColor, const u8* newColor) {
+	auto affected = [&](u8 r, u8 g, u8 b) {
+		u8 color[3] = { r, g, b };
+		return equal(color, color + 3, oldColor) || equal(color, color + 3, newColor);
+	};
+	bool platformsAffected = affected(255, 255, 255);
+	bool checkpointsAffected = affected(0, 255, 0);
+	bool patrolAffected = affected(255, 0, 0);
+	bool stationaryAffected = affected(255, 255, 0);
+	auto enemyAffected = [&](const Enemy& enemy) {
+		return enemy.type == Enemy::Type::PATROL ? patrolAffected : stationaryAffected;
+	};
+
+	bool grown = true;
+	auto absorb = [&](const Object& object) {
+		if (!overlaps(region, object)) {
+			return;
+		}
+		float right = max(region.x + region.width, object.x + object.width);
+		float bottom = max(region.y + region.height, object.y + object.height);
+		if (object.x < region.x || object.y < region.y || right > region.x + region.width || bottom > region.y + region.height) {
+			region.x = min(region.x, object.x);
+			region.y = min(region.y, object.y);
+			region.width = right - region.x;
+			region.height = bottom - region.y;
+			grown = true;
+		}
+	};
+	while (grown) {
+		grown = false;
+		if (platformsAffected) {
+			for (const auto& platform : platforms) {
+				absorb(platform);
+			}
+		}
+		if (checkpointsAffected) {
+			for (const auto& checkpoint : checkpoints) {
+				absorb(checkpoint);
+			}
+		}
+		for (const auto& enemy : enemies) {
+			if (enemyAffected(enemy)) {
+				absorb(enemyOrigin(enemy));
+			}
+		}
+	}
+
+	vector<Enemy> removedEnemies;
+	if (platformsAffected) {
+		platforms.erase(remove_if(platforms.begin(), platforms.end(), [&](const Platform& platform) { return overlaps(region, platform); }), platforms.end());
+	}
+	if (checkpointsAffected) {
+		checkpoints.erase(remove_if(checkpoints.begin(), checkpoints.end(), [&](const Checkpoint& checkpoint) { return overlaps(region, checkpoint); }), checkpoints.end());
+	}
+	enemies.erase(remove_if(enemies.begin(), enemies.end(), [&](const Enemy& enemy) {
+		if (enemyAffected(enemy) && overlaps(region, enemyOrigin(enemy))) {
+			removedEnemies.push_back(enemy);
+			return true;
+		}
+		return false;
+	}), enemies.end());
+
+	int minX = static_cast<int>(region.x / levelXScale), minY = static_cast<int>(region.y / levelYScale);
+	int maxX = static_cast<int>((region.x + region.width) / levelXScale), maxY = static_cast<int>((region.y + region.height) / levelYScale);
+	auto rebuild = [&](u8 r, u8 g, u8 b) {
+		return aggregateObject(levelImage.data(), levelWidth, levelHeight, r, g, b, minX, minY, maxX, maxY);
+	};
+	if (platformsAffected) {
+		for (const Object& platform : rebuild(255, 255, 255)) {
+			platforms.push_back({ platform });
+		}
+	}
+	if (checkpointsAffected) {
+		for (const Object& checkpoint : rebuild(0, 255, 0)) {
+			checkpoints.push_back({ checkpoint });
+		}
+	}
+	if (patrolAffected) {
+		for (const Object& enemy : rebuild(255, 0, 0)) {
+			// keep the speed of the enemy this one replaces so repainting doesn't reset it
+			float speed = DEFAULT_ENEMY_SPEED;
+			for (const Enemy& removed : removedEnemies) {
+				if (removed.type == Enemy::Type::PATROL && overlaps(enemy, enemyOrigin(removed))) {
+					speed = removed.dx;
+					break;
+				}
+			}
+			addEnemy(enemy, Enemy::Type::PATROL, speed);
+		}
+	}
+	if (stationaryAffected) {
+		for (const Object& enemy : rebuild(255, 255, 0)) {
+			addEnemy(enemy, Enemy::Type::STATIONARY);
+		}
 	}
 
-	SOIL_free_image_data(image);
+	// recorded states no longer line up with the enemies
+	history.clear();
 }
\ No newline at end of file
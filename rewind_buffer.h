@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// Fixed-size history of serialized world states, one per tick.
+// A tick is stored as is (a keyframe) every keyframeInterval ticks, and otherwise as the XOR against the latest keyframe with the runs of zero bytes squeezed out.
+// The encoded ticks are packed back to back into one byte ring with an offset/length index per tick, so the oldest ticks are dropped once either one is full.
+// Restoring a tick only ever touches one keyframe and one delta, no matter how far back it is.
+class RewindBuffer {
+public:
+	RewindBuffer(size_t tickCapacity, size_t byteCapacity, size_t keyframeInterval) : entries(max<size_t>(tickCapacity, 1)), keyframeInterval(max<size_t>(keyframeInterval, 1)) {
+		// a power of two so the 32-bit offsets can wrap around without breaking the ring position
+		size_t size = 1;
+		while (size < byteCapacity) {
+			size <<= 1;
+		}
+		bytes.resize(size);
+	}
+
+	void record(const vector<uint8_t>& state) {
+		if (state.size() + 1 > bytes.size()) {
+			// a single state bigger than the whole ring can't be kept
+			clear();
+			return;
+		}
+		size_t tick = nextTick;
+		bool delta = !empty() && lastKeyframe >= oldest && tick - lastKeyframe < keyframeInterval && entry(lastKeyframe).length == state.size() + 1;
+		encode(state, delta);
+		uint32_t offset = reserve(static_cast<uint32_t>(scratch.size()));
+		if (delta && (empty() || lastKeyframe < oldest)) {
+			// making room took the keyframe with it
+			delta = false;
+			encode(state, delta);
+			offset = reserve(static_cast<uint32_t>(scratch.size()));
+		}
+
+		copy(scratch.begin(), scratch.end(), bytes.begin() + (offset & (bytes.size() - 1)));
+		entry(tick) = { offset, static_cast<uint32_t>(scratch.size()) };
+		head = offset + static_cast<uint32_t>(scratch.size());
+		payload += scratch.size();
+		nextTick++;
+		if (!delta) {
+			lastKeyframe = tick;
+		}
+	}
+
+	bool restore(size_t tick, vector<uint8_t>& state) const {
+		if (empty() || tick < oldest || tick > newestTick()) {
+			return false;
+		}
+		const uint8_t* frame = data(tick);
+		const uint8_t* frameEnd = frame + entry(tick).length;
+		if (frame[0] == RAW) {
+			state.assign(frame + 1, frameEnd);
+		} else {
+			// the oldest tick is always a keyframe, so this stops in range
+			size_t keyframe = tick;
+			while (data(keyframe)[0] != RAW) {
+				keyframe--;
+			}
+			state.assign(data(keyframe) + 1, data(keyframe) + entry(keyframe).length);
+			decodeDelta(frame, frameEnd, state);
+		}
+		return true;
+	}
+
+	// Drop every tick after the given one so recording carries on from there.
+	void truncate(size_t tick) {
+		if (empty() || tick < oldest || tick >= newestTick()) {
+			return;
+		}
+		for (size_t dropped = tick + 1; dropped < nextTick; ++dropped) {
+			payload -= entry(dropped).length;
+		}
+		nextTick = tick + 1;
+		head = entry(tick).offset + entry(tick).length;
+		lastKeyframe = tick;
+		while (data(lastKeyframe)[0] != RAW) {
+			lastKeyframe--;
+		}
+	}
+
+	void clear() {
+		oldest = 0;
+		nextTick = 0;
+		payload = 0;
+	}
+
+	bool empty() const {
+		return nextTick == oldest;
+	}
+
+	size_t oldestTick() const {
+		return oldest;
+	}
+
+	size_t newestTick() const {
+		return nextTick - 1;
+	}
+
+	size_t tickCount() const {
+		return nextTick - oldest;
+	}
+
+	// Encoded bytes of the ticks currently held.
+	size_t payloadSize() const {
+		return payload;
+	}
+
+	// Everything allocated up front, used or not.
+	size_t memoryUsage() const {
+		return sizeof(*this) + bytes.capacity() + entries.capacity() * sizeof(Entry) + scratch.capacity();
+	}
+
+private:
+	enum : uint8_t { RAW, DELTA };
+
+	struct Entry {
+		uint32_t offset;	// keeps counting up past the end of the ring
+		uint32_t length;
+	};
+
+	vector<uint8_t> bytes;
+	vector<Entry> entries;
+	vector<uint8_t> scratch;
+	size_t keyframeInterval;
+	size_t oldest = 0;
+	size_t nextTick = 0;
+	size_t lastKeyframe = 0;
+	size_t payload = 0;
+	uint32_t head = 0;
+
+	Entry& entry(size_t tick) {
+		return entries[tick % entries.size()];
+	}
+
+	const Entry& entry(size_t tick) const {
+		return entries[tick % entries.size()];
+	}
+
+	const uint8_t* data(size_t tick) const {
+		return bytes.data() + (entry(tick).offset & (bytes.size() - 1));
+	}
+
+	void encode(const vector<uint8_t>& state, bool delta) {
+		scratch.clear();
+		if (delta) {
+			encodeDelta(state, data(lastKeyframe) + 1, scratch);
+		} else {
+			scratch.push_back(RAW);
+			scratch.insert(scratch.end(), state.begin(), state.end());
+		}
+	}
+
+	// Find a contiguous spot for the next frame, dropping the oldest ticks until it's free.
+	uint32_t reserve(uint32_t length) {
+		uint32_t ringSize = static_cast<uint32_t>(bytes.size());
+		uint32_t offset = head;
+		if ((offset & (ringSize - 1)) + length > ringSize) {
+			// frames never wrap, skip to the start of the ring instead
+			offset += ringSize - (offset & (ringSize - 1));
+		}
+		uint32_t end = offset + length;
+		while (!empty() && (end - entry(oldest).offset > ringSize || tickCount() >= entries.size())) {
+			evictOldest();
+		}
+		return offset;
+	}
+
+	// Deltas can't outlive their keyframe, so the rest of its group goes too.
+	void evictOldest() {
+		do {
+			payload -= entry(oldest).length;
+			oldest++;
+		} while (!empty() && data(oldest)[0] != RAW);
+	}
+
+	// Delta layout: DELTA, then (zero run, literal run, literal bytes...) triples with one-byte run lengths.
+	static void encodeDelta(const vector<uint8_t>& state, const uint8_t* keyframe, vector<uint8_t>& out) {
+		out.push_back(DELTA);
+		size_t i = 0;
+		while (i < state.size()) {
+			uint8_t zeros = 0;
+			while (i < state.size() && zeros < 255 && state[i] == keyframe[i]) {
+				zeros++;
+				i++;
+			}
+			size_t lengthPos = out.size() + 1;
+			out.push_back(zeros);
+			out.push_back(0);
+			while (i < state.size() && out[lengthPos] < 255 && state[i] != keyframe[i]) {
+				out.push_back(state[i] ^ keyframe[i]);
+				out[lengthPos]++;
+				i++;
+			}
+		}
+	}
+
+	static void decodeDelta(const uint8_t* delta, const uint8_t* deltaEnd, vector<uint8_t>& state) {
+		size_t i = 0;
+		const uint8_t* pos = delta + 1;
+		while (pos + 1 < deltaEnd) {
+			i += *pos++;
+			uint8_t literals = *pos++;
+			for (uint8_t j = 0; j < literals; ++j) {
+				state[i++] ^= *pos++;
+			}
+		}
+	}
+};